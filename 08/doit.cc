@@ -5,58 +5,322 @@
 
 #include <iostream>
 #include <string>
-#include <map>
-#include <numeric>
+#include <vector>
+#include <bitset>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
 #include <cassert>
 
 using namespace std;
 
+// Node names are three characters from [0-9A-Z], so they pack into a
+// base-36 integer that fits in 16 bits
+using node = uint16_t;
+constexpr unsigned num_nodes = 36 * 36 * 36;
+
+unsigned digit(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  assert(c >= 'A' && c <= 'Z');
+  return c - 'A' + 10;
+}
+
+node encode(string const &name) {
+  assert(name.length() == 3);
+  return (digit(name[0]) * 36 + digit(name[1])) * 36 + digit(name[2]);
+}
+
 string steps;
-map<string, pair<string, string>> network;
+// Successors of each node
+node left_of[num_nodes];
+node right_of[num_nodes];
+// Which nodes exist, and which end in A or Z
+bitset<num_nodes> present;
+bitset<num_nodes> ends_in_A;
+bitset<num_nodes> ends_in_Z;
+// Dense numbering of the nodes that exist
+unsigned dense_id[num_nodes];
+unsigned num_present = 0;
 
 void read() {
   cin >> steps;
   string start, equals, left, right;
   while (cin >> start >> equals >> left >> right) {
-    assert(network.find(start) == network.end());
     assert(left.length() == 5 && right.length() == 4);
-    network.emplace(start, make_pair(left.substr(1, 3), right.substr(0, 3)));
+    node n = encode(start);
+    assert(!present[n]);
+    present[n] = true;
+    dense_id[n] = num_present++;
+    ends_in_A[n] = start.back() == 'A';
+    ends_in_Z[n] = start.back() == 'Z';
+    left_of[n] = encode(left.substr(1, 3));
+    right_of[n] = encode(right.substr(0, 3));
   }
 }
 
-int perchance_to_dream(string loc) {
-  int num_steps = 0;
-  while (loc.back() != 'Z') {
-    assert(network.find(loc) != network.end());
-    auto const &[left, right] = network.find(loc)->second;
-    loc = steps[num_steps++ % steps.length()] == 'L' ? left : right;
+// Follow instruction i from loc
+node follow(node loc, size_t i) {
+  assert(present[loc]);
+  return steps[i % steps.length()] == 'L' ? left_of[loc] : right_of[loc];
+}
+
+// Binary lifting over whole passes through steps, so that queries
+// about where a walk goes take time logarithmic in the walk length
+struct jump_table {
+  // jump[k][n] = node reached from n after 2^k full passes
+  vector<vector<node>> jump;
+  // first_Z[k][n] = steps from n until the first Z node within 2^k
+  // full passes, or -1 if none is hit
+  vector<vector<long>> first_Z;
+
+  jump_table();
+
+  // Steps from start until reaching a Z node, or -1 if never
+  long steps_to_Z(node start) const;
+  // Node reached from start after n steps
+  node after(node start, long n) const;
+};
+
+jump_table::jump_table() {
+  long len = steps.length();
+  // Each level doubles the passes; 63 levels covers any long step count
+  jump.assign(63, vector<node>(num_nodes, 0));
+  // Passes from any node are eventually periodic with tail + cycle
+  // at most the number of nodes, so if no Z has been hit by then,
+  // none ever will be
+  unsigned z_levels = 1;
+  while ((size_t(1) << (z_levels - 1)) < present.count())
+    ++z_levels;
+  first_Z.assign(z_levels, vector<long>(num_nodes, -1));
+  for (unsigned n = 0; n < num_nodes; ++n) {
+    if (!present[n])
+      continue;
+    node loc = n;
+    for (long i = 0; i < len; ++i) {
+      if (first_Z[0][n] == -1 && ends_in_Z[loc])
+        first_Z[0][n] = i;
+      loc = follow(loc, i);
+    }
+    jump[0][n] = loc;
   }
-  // The code for part 2 relies on the assumption that the network
-  // cycles with the same period and ends exactly at the end of the
-  // number of steps.  The code below verifies this at the cost of
-  // going around twice.
-  /*
-  assert(num_steps % steps.length() == 0);
-  int num_steps1 = num_steps;
-  string loc1 = loc;
-  do {
-    assert(network.find(loc) != network.end());
-    auto const &[left, right] = network.find(loc)->second;
-    loc = steps[num_steps1++ % steps.length()] == 'L' ? left : right;
-  } while (loc.back() != 'Z');
-  assert(loc1 == loc && num_steps1 == 2 * num_steps);
-  */
+  for (unsigned k = 1; k < jump.size(); ++k)
+    for (unsigned n = 0; n < num_nodes; ++n)
+      if (present[n])
+        jump[k][n] = jump[k - 1][jump[k - 1][n]];
+  for (unsigned k = 1; k < first_Z.size(); ++k)
+    for (unsigned n = 0; n < num_nodes; ++n) {
+      if (!present[n])
+        continue;
+      if (first_Z[k - 1][n] != -1)
+        first_Z[k][n] = first_Z[k - 1][n];
+      else if (long rest = first_Z[k - 1][jump[k - 1][n]]; rest != -1)
+        first_Z[k][n] = (len << (k - 1)) + rest;
+    }
+}
+
+long jump_table::steps_to_Z(node start) const {
+  if (first_Z.back()[start] == -1)
+    return -1;
+  long num_steps = 0;
+  for (unsigned k = first_Z.size(); k-- > 0;)
+    if (first_Z[k][start] == -1) {
+      num_steps += long(steps.length()) << k;
+      start = jump[k][start];
+    }
+  return num_steps + first_Z[0][start];
+}
+
+node jump_table::after(node start, long n) const {
+  assert(n >= 0);
+  long passes = n / steps.length();
+  for (unsigned k = 0; passes != 0; ++k, passes >>= 1)
+    if (passes & 1)
+      start = jump[k][start];
+  for (size_t i = 0; i < n % steps.length(); ++i)
+    start = follow(start, i);
+  return start;
+}
+
+long perchance_to_dream(jump_table const &jt, node loc) {
+  long num_steps = jt.steps_to_Z(loc);
+  assert(num_steps != -1);
   return num_steps;
 }
 
-void part1() { cout << perchance_to_dream("AAA") << '\n'; }
+void part1() {
+  cout << perchance_to_dream(jump_table(), encode("AAA")) << '\n';
+}
+
+// Where a ghost is at Z nodes.  The state is (node, instruction
+// index), so the walk enters a cycle after at most num_present *
+// steps.length() steps.
+struct ghost {
+  // Steps before entering the cycle
+  long tail;
+  // Length of the cycle
+  long cycle;
+  // Times < tail at a Z node
+  vector<long> tail_Zs;
+  // Times in [tail, tail + cycle) at a Z node
+  vector<long> cycle_Zs;
+
+  ghost(node start);
+
+  bool at_Z(long t) const;
+};
+
+ghost::ghost(node start) {
+  size_t len = steps.length();
+  // First time each state was seen
+  vector<long> seen(num_present * len, -1);
+  vector<long> Zs;
+  node loc = start;
+  long t = 0;
+  for (;;) {
+    size_t state = dense_id[loc] * len + t % len;
+    if (seen[state] != -1) {
+      tail = seen[state];
+      break;
+    }
+    seen[state] = t;
+    if (ends_in_Z[loc])
+      Zs.push_back(t);
+    loc = follow(loc, t++);
+  }
+  cycle = t - tail;
+  for (auto z : Zs)
+    (z < tail ? tail_Zs : cycle_Zs).push_back(z);
+}
+
+bool ghost::at_Z(long t) const {
+  if (t < tail)
+    return binary_search(tail_Zs.begin(), tail_Zs.end(), t);
+  t = tail + (t - tail) % cycle;
+  return binary_search(cycle_Zs.begin(), cycle_Zs.end(), t);
+}
+
+// Extended Euclid; returns g = gcd(a, b) and sets x, y so that a * x +
+// b * y = g
+long ext_gcd(long a, long b, long &x, long &y) {
+  if (b == 0) {
+    x = 1;
+    y = 0;
+    return a;
+  }
+  long x1, y1;
+  long g = ext_gcd(b, a % b, x1, y1);
+  x = y1;
+  y = x1 - (a / b) * y1;
+  return g;
+}
+
+// Generalized Chinese remainder theorem: combine t = a (mod m) and t =
+// b (mod n), with moduli not necessarily coprime.  Sets m to lcm(m,
+// n) either way, and returns the combined residue, or -1 if there's
+// no solution.
+long crt(long a, long &m, long b, long n) {
+  long x, y;
+  long g = ext_gcd(m, n, x, y);
+  long l = m / g * n;
+  assert(l / n == m / g);
+  long old_m = m;
+  m = l;
+  if ((b - a) % g != 0)
+    return -1;
+  long ng = n / g;
+  // m * k = b - a (mod n) => k = (b - a) / g * x (mod n / g)
+  __int128 k = (__int128((b - a) / g) * x) % ng;
+  if (k < 0)
+    k += ng;
+  __int128 t = (a + __int128(old_m) * k) % l;
+  return t < 0 ? long(t + l) : long(t);
+}
 
 void part2() {
-  long ans = 1;
-  for (auto const &[start, _] : network)
-    if (start.back() == 'A')
-      ans = lcm(ans, perchance_to_dream(start));
-  cout << ans << '\n';
+  vector<ghost> ghosts;
+  long max_tail = 0;
+  long max_cycle = 0;
+  for (unsigned start = 0; start < num_nodes; ++start)
+    if (ends_in_A[start]) {
+      ghosts.emplace_back(start);
+      max_tail = max(max_tail, ghosts.back().tail);
+      max_cycle = max(max_cycle, ghosts.back().cycle);
+    }
+  auto all_at_Z = [&](long t) {
+    return all_of(ghosts.begin(), ghosts.end(),
+                  [=](ghost const &g) { return g.at_Z(t); });
+  };
+  // Until everyone is cycling, and then for as long as the longest
+  // cycle, just check directly.  That's bounded by the state space,
+  // and small answers turn up right away.
+  for (long t = 0; t < max_tail + max_cycle; ++t)
+    if (all_at_Z(t)) {
+      cout << t << '\n';
+      return;
+    }
+  // Afterwards each ghost is at a Z when t matches one of its cycle
+  // residues.  Combine the possibilities for the ghosts with the
+  // fewest Zs first, but only while the combined set stays small
+  // (the full product can be huge).
+  sort(ghosts.begin(), ghosts.end(), [](ghost const &g1, ghost const &g2) {
+    return g1.cycle_Zs.size() < g2.cycle_Zs.size();
+  });
+  size_t const max_residues = 1 << 12;
+  long mod = 1;
+  vector<long> residues{0};
+  size_t num_combined = 0;
+  for (; num_combined < ghosts.size(); ++num_combined) {
+    auto const &g = ghosts[num_combined];
+    if (num_combined > 0 &&
+        residues.size() * g.cycle_Zs.size() > max_residues)
+      break;
+    vector<long> combined;
+    long new_mod = mod;
+    for (auto r : residues)
+      for (auto z : g.cycle_Zs) {
+        long m = mod;
+        long t = crt(r, m, z % g.cycle, g.cycle);
+        if (t != -1)
+          combined.push_back(t);
+        new_mod = m;
+      }
+    sort(combined.begin(), combined.end());
+    combined.erase(unique(combined.begin(), combined.end()), combined.end());
+    residues = combined;
+    mod = new_mod;
+  }
+  // Everything repeats after the lcm of the cycles
+  __int128 period = 1;
+  long const max_period = numeric_limits<long>::max() / 4;
+  for (auto const &g : ghosts) {
+    long x, y;
+    long d = ext_gcd(long(period % g.cycle), g.cycle, x, y);
+    period = min<__int128>(period / d * g.cycle, max_period);
+  }
+  long limit = max_tail + long(period);
+  // Sieve the rest: step through the times >= max_tail matching the
+  // combined residues in order, and test the other ghosts directly
+  vector<long> offsets;
+  for (auto r : residues)
+    offsets.push_back(((r - max_tail) % mod + mod) % mod);
+  sort(offsets.begin(), offsets.end());
+  for (long base = max_tail; !offsets.empty(); base += mod) {
+    for (auto offset : offsets) {
+      long t = base + offset;
+      if (t >= limit)
+        break;
+      if (all_of(ghosts.begin() + num_combined, ghosts.end(),
+                 [=](ghost const &g) { return g.at_Z(t); })) {
+        assert(all_at_Z(t));
+        cout << t << '\n';
+        return;
+      }
+    }
+    if (limit - base <= mod)
+      break;
+  }
+  cout << "never\n";
 }
 
 int main(int argc, char **argv) {
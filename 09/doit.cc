@@ -7,34 +7,143 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <map>
+#include <optional>
+#include <limits>
 #include <algorithm>
+#include <type_traits>
 #include <cassert>
 
 using namespace std;
 
-int extrapolate(vector<int> ns) {
-  if (all_of(ns.begin(), ns.end(), [](int n) { return n == 0; }))
-    return 0;
-  vector<int> diffs;
-  for (size_t i = 0; i + 1 < ns.size(); ++i)
-    diffs.push_back(ns[i + 1] - ns[i]);
-  return ns.back() + extrapolate(diffs);
+using num = long;
+// Sums of products can overflow num even when the extrapolated value
+// fits, so the arithmetic is done unsigned, which wraps by definition
+// and is exact mod 2^64; the final answer is converted back at the end
+using unum = make_unsigned_t<num>;
+
+// Next value of ns[0, len), computed by repeatedly replacing the
+// sequence with its differences in place.  The extrapolated value is
+// the sum of the last elements of each level.  Clobbers ns.
+unum extrapolate(unum *ns, size_t len) {
+  unum result = 0;
+  while (len > 0) {
+    result += ns[len - 1];
+    bool all_zero = true;
+    for (size_t i = 0; i + 1 < len; ++i) {
+      ns[i] = ns[i + 1] - ns[i];
+      all_zero = all_zero && ns[i] == 0;
+    }
+    if (all_zero)
+      break;
+    --len;
+  }
+  return result;
+}
+
+// Generalized binomial coefficient a choose k for any integer a, or
+// nullopt if it doesn't fit comfortably in a num
+optional<__int128> choose(num a, num k) {
+  __int128 c = 1;
+  for (num j = 0; j < k; ++j) {
+    // Exact, since C(a, j) * (a - j) = C(a, j + 1) * (j + 1)
+    c = c * (a - j) / (j + 1);
+    if (c > numeric_limits<num>::max() || c < numeric_limits<num>::min())
+      return nullopt;
+  }
+  return c;
+}
+
+// Weights w such that the polynomial of degree < len through (i,
+// ns[i]) for i in [0, len) has value sum_i w[i] * ns[i] at position
+// x.  This is what repeated differencing computes, in Lagrange form:
+// w[i] = C(x, i) * C(len - 1 - x, len - 1 - i).  Empty if the weights
+// overflow.
+vector<num> weights(size_t len, num x) {
+  vector<num> w(len);
+  for (size_t i = 0; i < len; ++i) {
+    auto c1 = choose(x, i);
+    auto c2 = choose(num(len) - 1 - x, len - 1 - i);
+    if (!c1 || !c2)
+      return {};
+    __int128 wi = *c1 * *c2;
+    if (wi > numeric_limits<num>::max() || wi < numeric_limits<num>::min())
+      return {};
+    w[i] = wi;
+  }
+  return w;
+}
+
+// Extrapolate a batch of num_seqs sequences, each of length len, to
+// several horizons at once.  The batch is a column-major matrix with
+// one row per sequence, i.e., element i of sequence s is at data[i *
+// num_seqs + s].  A horizon of +k means k past the last element, -k
+// means k before the first.  Returns result[h][s] for horizons[h], or
+// empty if the weights for some horizon overflow.
+vector<vector<unum>> extrapolate(vector<unum> const &data, size_t num_seqs,
+                                 size_t len, vector<num> const &horizons) {
+  assert(data.size() == num_seqs * len);
+  vector<vector<unum>> result;
+  for (auto h : horizons) {
+    assert(h != 0);
+    auto w = weights(len, h > 0 ? num(len) - 1 + h : h);
+    if (w.empty())
+      return {};
+    vector<unum> out(num_seqs, 0);
+    // Each column is contiguous, so this vectorizes across sequences
+    for (size_t i = 0; i < len; ++i) {
+      unum const wi = w[i];
+      unum const *col = &data[i * num_seqs];
+      for (size_t s = 0; s < num_seqs; ++s)
+        out[s] += wi * col[s];
+    }
+    result.push_back(move(out));
+  }
+  return result;
 }
 
 void solve(bool backwards) {
-  int ans = 0;
   string line;
+  istringstream ss;
+  vector<num> ns;
+  // Sequences grouped by length, each in column-major order
+  map<size_t, vector<unum>> batches;
   while (getline(cin, line)) {
-    stringstream ss(line);
-    vector<int> ns;
-    int n;
+    ss.clear();
+    ss.str(line);
+    ns.clear();
+    num n;
     while (ss >> n)
       ns.push_back(n);
-    if (backwards)
-      reverse(ns.begin(), ns.end());
-    ans += extrapolate(ns);
+    auto &batch = batches[ns.size()];
+    batch.insert(batch.end(), ns.begin(), ns.end());
+  }
+  unum ans = 0;
+  for (auto &[len, batch] : batches) {
+    if (len == 0)
+      continue;
+    size_t num_seqs = batch.size() / len;
+    // Transpose to column-major
+    vector<unum> data(batch.size());
+    for (size_t s = 0; s < num_seqs; ++s)
+      for (size_t i = 0; i < len; ++i)
+        data[i * num_seqs + s] = batch[s * len + i];
+    auto result = extrapolate(data, num_seqs, len, {backwards ? -1 : 1});
+    if (!result.empty()) {
+      for (auto v : result.front())
+        ans += v;
+      continue;
+    }
+    // Long sequences where the weights overflow; difference them
+    // individually
+    for (size_t s = 0; s < num_seqs; ++s) {
+      unum *seq = &batch[s * len];
+      if (backwards)
+        reverse(seq, seq + len);
+      ans += extrapolate(seq, len);
+    }
   }
-  cout << ans << '\n';
+  cout << num(ans) << '\n';
 }
 
 void part1() { solve(false); }
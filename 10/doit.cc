@@ -1,13 +1,15 @@
 // -*- C++ -*-
-// g++ -std=c++17 -Wall -g -o doit doit.cc
+// g++ -std=c++17 -Wall -g -pthread -o doit doit.cc
 // ./doit 1 < input  # part 1
 // ./doit 2 < input  # part 2
 
 #include <iostream>
 #include <string>
 #include <vector>
-#include <list>
-#include <map>
+#include <array>
+#include <cstdint>
+#include <numeric>
+#include <thread>
 #include <cassert>
 
 using namespace std;
@@ -24,6 +26,22 @@ coord operator-(coord const &c1, coord const &c2) {
 
 coord adjacent[4] = {{+1, 0}, {0, +1}, {-1, 0}, {0, -1}};
 
+// Bit d of pipe_mask[p] is set if pipe p connects in direction
+// adjacent[d]; the opposite direction is (d + 2) % 4
+constexpr array<uint8_t, 256> make_pipe_mask() {
+  array<uint8_t, 256> mask{};
+  mask['-'] = 0b0101;
+  mask['|'] = 0b1010;
+  mask['F'] = 0b0011;
+  mask['7'] = 0b0110;
+  mask['J'] = 0b1100;
+  mask['L'] = 0b1001;
+  mask['S'] = 0b1111;
+  return mask;
+}
+
+constexpr array<uint8_t, 256> pipe_mask = make_pipe_mask();
+
 struct pipes {
   coord start;
   vector<string> maze;
@@ -38,11 +56,15 @@ struct pipes {
   // If c1 is part of the loop, then is c2 also part of it?
   bool connected(coord const &c1, coord const &c2) const;
 
-  // Distance from start to everything in the loop
-  map<coord, int> dist_from_start() const;
+  // Index of c in a flat width() * height() array
+  int index(coord const &c) const { return c.second * width() + c.first; }
+
+  // Distance from start to everything in the loop, indexed by
+  // index(); -1 for things not in the loop
+  vector<int32_t> dist_from_start() const;
 
   // Pitch pointless peripheral pipe pieces for pretty printing
-  void clean_up(map<coord, int> const &dist);
+  void clean_up(vector<int32_t> const &dist);
 
   // How much space is inside the loop?
   int num_inside();
@@ -68,52 +90,49 @@ char pipes::at(coord const &c) const {
 };
 
 bool pipes::connected(coord const &c1, coord const &c2) const {
-  char p1 = at(c1);
-  assert(p1 != '.');
-  char p2 = at(c2);
-  if (p2 == '.')
-    return false;
-  auto is = [](char p, string const &ok) { return ok.find(p) != string::npos; };
-  coord delta = c2 - c1;
-  if (delta == pair{+1, 0} && is(p1, "S-FL") && is(p2, "-7J"))
-    return true;
-  if (delta == pair{-1, 0} && is(p1, "S-7J") && is(p2, "-FL"))
-    return true;
-  // N.B., second coordinate increasing means "going down"
-  if (delta == pair{0, +1} && is(p1, "S|7F") && is(p2, "|JL"))
-    return true;
-  // Decreasing means "going up"
-  if (delta == pair{0, -1} && is(p1, "S|JL") && is(p2, "|7F"))
-    return true;
+  uint8_t m1 = pipe_mask[(unsigned char)at(c1)];
+  assert(m1 != 0);
+  uint8_t m2 = pipe_mask[(unsigned char)at(c2)];
+  for (int d = 0; d < 4; ++d)
+    if (c2 - c1 == adjacent[d])
+      return (m1 >> d) & (m2 >> (d + 2) % 4) & 1;
   return false;
 }
 
-map<coord, int> pipes::dist_from_start() const {
-  map<coord, int> dist;
-  dist[start] = 0;
-  list<coord> to_search(1, start);
-  while (!to_search.empty()) {
-    assert(to_search.size() <= 2);
-    coord c1 = to_search.front();
-    to_search.pop_front();
-    for (auto adj : adjacent) {
-      coord c2 = c1 + adj;
-      if (!dist.count(c2) && connected(c1, c2)) {
-        dist[c2] = dist[c1] + 1;
-        to_search.push_back(c2);
+vector<int32_t> pipes::dist_from_start() const {
+  vector<int32_t> dist(width() * height(), -1);
+  dist[index(start)] = 0;
+  // The loop only ever has two heads
+  coord frontier[2] = {start};
+  int num_frontier = 1;
+  while (num_frontier > 0) {
+    coord next[2];
+    int num_next = 0;
+    for (int f = 0; f < num_frontier; ++f) {
+      coord c1 = frontier[f];
+      int d1 = dist[index(c1)];
+      for (auto adj : adjacent) {
+        coord c2 = c1 + adj;
+        if (at(c2) == '.' || dist[index(c2)] != -1 || !connected(c1, c2))
+          continue;
+        dist[index(c2)] = d1 + 1;
+        assert(num_next < 2);
+        next[num_next++] = c2;
       }
     }
+    copy(next, next + num_next, frontier);
+    num_frontier = num_next;
   }
   return dist;
 }
 
-void pipes::clean_up(map<coord, int> const &dist) {
+void pipes::clean_up(vector<int32_t> const &dist) {
   vector<coord> dist1;
   for (int j = 0; j < height(); ++j)
     for (int i = 0; i < width(); ++i)
-      if (!dist.count({i, j}))
+      if (dist[index({i, j})] == -1)
         maze[j][i] = '.';
-      else if (dist.find({i, j})->second == 1)
+      else if (dist[index({i, j})] == 1)
         dist1.emplace_back(i, j);
   // Have to fix up S to match whatever the neighbors are for
   // num_inside to work!  I got lucky on my input...
@@ -126,28 +145,55 @@ void pipes::clean_up(map<coord, int> const &dist) {
   assert(connected(dist1[0], start) && connected(dist1[1], start));
 }
 
+// Inclusive prefix XOR of the bits of x, from low bits to high
+uint64_t prefix_xor(uint64_t x) {
+  for (int shift = 1; shift < 64; shift *= 2)
+    x ^= x << shift;
+  return x;
+}
+
 int pipes::num_inside() {
   clean_up(dist_from_start());
-  int result = 0;
-  for (int j = 0; j < height(); ++j) {
-    int crossings = 0;
-    // crossing = number of vertical edges passed; an odd number means
-    // I'm inside the loop.  One subtlety is that the bends have to be
-    // consistent.
-    for (int i = 0; i < width(); ++i) {
-      char p = at({i, j});
-      if (p == '.' && crossings % 2 == 1)
-        ++result;
-      else if (p == '|' || p == 'L' || p == 'J')
-        ++crossings;
+  // Each row is handled 64 cells at a time.  crossings = number of
+  // vertical edges passed; an odd number means I'm inside the loop.
+  // One subtlety is that the bends have to be consistent, so only |,
+  // L, and J count as crossings.
+  int words = (width() + 63) / 64;
+  auto row_inside = [&](int j) {
+    int result = 0;
+    uint64_t parity = 0;
+    for (int w = 0; w < words; ++w) {
+      uint64_t loop = 0, crossing = 0;
+      for (int b = 0; b < 64 && 64 * w + b < width(); ++b) {
+        char p = maze[j][64 * w + b];
+        loop |= uint64_t(p != '.') << b;
+        crossing |= uint64_t(p == '|' || p == 'L' || p == 'J') << b;
+      }
+      // Only loop cells cross, so for non-loop cells the inclusive
+      // parity is the same as the parity of crossings before them
+      uint64_t odd = prefix_xor(crossing) ^ -parity;
+      result += __builtin_popcountll(odd & ~loop);
+      parity ^= __builtin_popcountll(crossing) & 1;
     }
-  }
-  return result;
+    return result;
+  };
+  // Rows are independent, so split them across threads
+  unsigned num_threads = max(1u, thread::hardware_concurrency());
+  vector<int> counts(num_threads, 0);
+  vector<thread> workers;
+  for (unsigned t = 0; t < num_threads; ++t)
+    workers.emplace_back([&, t] {
+      for (int j = t; j < height(); j += num_threads)
+        counts[t] += row_inside(j);
+    });
+  for (auto &worker : workers)
+    worker.join();
+  return accumulate(counts.begin(), counts.end(), 0);
 }
 
 void part1() {
   int ans = 0;
-  for (auto const &[_, d] : pipes().dist_from_start())
+  for (auto d : pipes().dist_from_start())
     ans = max(ans, d);
   cout << ans << '\n';
 }
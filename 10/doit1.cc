@@ -5,120 +5,150 @@
 
 // Alternative version based on discussion with Footkick72
 
+// The loop is traced directly in the (memory-mapped, if possible)
+// input, keeping only the running shoelace sum and the loop length,
+// so the maze never has to fit in memory as anything else.
+
 #include <iostream>
+#include <iterator>
 #include <string>
-#include <vector>
+#include <array>
+#include <cstdint>
+#include <cstring>
 #include <cassert>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
-using coord = pair<int, int>;
-
-coord operator+(coord const &c1, coord const &c2) {
-  return coord{c1.first + c2.first, c1.second + c2.second};
+// Directions are east, south, west, north; the opposite of d is (d +
+// 2) % 4.  N.B., y increasing means "going down".
+int const dx[4] = {+1, 0, -1, 0};
+int const dy[4] = {0, +1, 0, -1};
+
+// Bit d of pipe_mask[p] is set if pipe p connects in direction d
+constexpr array<uint8_t, 256> make_pipe_mask() {
+  array<uint8_t, 256> mask{};
+  mask['-'] = 0b0101;
+  mask['|'] = 0b1010;
+  mask['F'] = 0b0011;
+  mask['7'] = 0b0110;
+  mask['J'] = 0b1100;
+  mask['L'] = 0b1001;
+  return mask;
 }
 
-coord operator-(coord const &c1, coord const &c2) {
-  return coord{c1.first - c2.first, c1.second - c2.second};
+constexpr array<uint8_t, 256> pipe_mask = make_pipe_mask();
+
+// turn[p][d] = direction of travel after entering pipe p going in
+// direction d, or 4 if p doesn't accept d
+constexpr array<array<uint8_t, 4>, 256> make_turn() {
+  array<array<uint8_t, 4>, 256> turn{};
+  for (unsigned p = 0; p < 256; ++p)
+    for (unsigned d = 0; d < 4; ++d) {
+      turn[p][d] = 4;
+      unsigned back = (d + 2) % 4;
+      if (!(pipe_mask[p] & (1 << back)))
+        continue;
+      for (unsigned out = 0; out < 4; ++out)
+        if (out != back && (pipe_mask[p] & (1 << out)))
+          turn[p][d] = out;
+    }
+  return turn;
 }
 
+constexpr array<array<uint8_t, 4>, 256> turn = make_turn();
+
 struct pipes {
-  coord start;
-  vector<string> maze;
+  // The maze as raw bytes with newline-terminated rows
+  char const *data;
+  size_t size;
+  // Either the mapping or a copy of stdin if it's not mappable
+  bool mapped;
+  string copy;
+  // Bytes per row, including the newline
+  long stride;
+  long width;
+  long height;
+  long start;
 
   // Construct from cin
   pipes();
+  ~pipes();
 
-  int width() const { return maze.front().length(); }
-  int height() const { return maze.size(); }
-  char at(coord const &c) const;
-
-  // If c1 is part of the loop, then is c2 also part of it?
-  bool connected(coord const &c1, coord const &c2) const;
-  // Find the two coordinates adjacent to c
-  vector<coord> adjacent_to(coord const &c) const;
-
-  // Find the loop
-  vector<coord> loop() const;
+  // Trace the loop, returning its length and twice its signed area
+  pair<long, long> trace() const;
 };
 
 pipes::pipes() {
-  string line;
-  while (getline(cin, line)) {
-    auto S = line.find('S');
-    if (S != string::npos)
-      start = {S, maze.size()};
-    maze.push_back(line);
-    assert(maze.front().length() == line.length());
+  struct stat st;
+  void *m = MAP_FAILED;
+  if (fstat(0, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, 0, 0);
+  mapped = m != MAP_FAILED;
+  if (mapped) {
+    data = static_cast<char const *>(m);
+    size = st.st_size;
+    madvise(m, size, MADV_SEQUENTIAL);
+  } else {
+    copy.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+    data = copy.data();
+    size = copy.size();
   }
+  auto nl = static_cast<char const *>(memchr(data, '\n', size));
+  width = nl ? nl - data : size;
+  stride = width + 1;
+  height = (size + 1) / stride;
+  auto S = static_cast<char const *>(memchr(data, 'S', size));
+  assert(S);
+  start = S - data;
 }
 
-char pipes::at(coord const &c) const {
-  if (c.first < 0 || c.first >= width())
-    return '.';
-  if (c.second < 0 || c.second >= height())
-    return '.';
-  return maze[c.second][c.first];
-};
-
-bool pipes::connected(coord const &c1, coord const &c2) const {
-  char p1 = at(c1);
-  assert(p1 != '.');
-  char p2 = at(c2);
-  if (p2 == '.')
-    return false;
-  if (p2 == 'S')
-    return connected(c2, c1);
-  auto is = [](char p, string const &ok) { return ok.find(p) != string::npos; };
-  coord delta = c2 - c1;
-  if (delta == pair{+1, 0} && is(p1, "S-FL") && is(p2, "-7J"))
-    return true;
-  if (delta == pair{-1, 0} && is(p1, "S-7J") && is(p2, "-FL"))
-    return true;
-  // N.B., second coordinate increasing means "going down"
-  if (delta == pair{0, +1} && is(p1, "S|7F") && is(p2, "|JL"))
-    return true;
-  // Decreasing means "going up"
-  if (delta == pair{0, -1} && is(p1, "S|JL") && is(p2, "|7F"))
-    return true;
-  return false;
+pipes::~pipes() {
+  if (mapped)
+    munmap(const_cast<char *>(data), size);
 }
 
-vector<coord> pipes::adjacent_to(coord const &c) const {
-  vector<coord> result;
-  for (auto adj : {coord{+1, 0}, coord{0, +1}, coord{-1, 0}, coord{0, -1}})
-    if (connected(c, c + adj))
-      result.push_back(c + adj);
-  return result;
-}
-
-vector<coord> pipes::loop() const {
-  coord next = adjacent_to(start).back();
-  vector<coord> result(1, start);
-  while (next != start) {
-    coord prev = result.back();
-    result.push_back(next);
-    auto next_next = adjacent_to(next);
-    next = next_next.front() == prev ? next_next.back() : next_next.front();
+pair<long, long> pipes::trace() const {
+  long x = start % stride;
+  long y = start / stride;
+  // Find some direction from S that leads into a connecting pipe
+  int d = 0;
+  for (; d < 4; ++d) {
+    long nx = x + dx[d], ny = y + dy[d];
+    if (nx < 0 || nx >= width || ny < 0 || ny >= height)
+      continue;
+    if (turn[(unsigned char)data[ny * stride + nx]][d] != 4)
+      break;
   }
-  return result;
+  assert(d < 4);
+  long const delta[4] = {+1, stride, -1, -stride};
+  long pos = start;
+  long length = 0;
+  // Area of loop by Green's theorem; only vertical steps contribute
+  long twice_area = 0;
+  do {
+    pos += delta[d];
+    x += dx[d];
+    twice_area += 2 * x * dy[d];
+    ++length;
+    if (pos == start)
+      break;
+    d = turn[(unsigned char)data[pos]][d];
+    assert(d != 4);
+  } while (true);
+  return {length, twice_area};
 }
 
-void part1() { cout << pipes().loop().size() / 2 << '\n'; }
+void part1() { cout << pipes().trace().first / 2 << '\n'; }
 
 void part2() {
-  auto loop = pipes().loop();
-  // Area of loop by Green's theorem
-  int twice_area = 0;
-  auto prev = loop.back();
-  for (auto const &c : loop) {
-    twice_area += (c.first + prev.first) * (c.second - prev.second);
-    prev = c;
-  }
+  auto [length, twice_area] = pipes().trace();
   // The loop orientation is random, so area could be negative
   twice_area = abs(twice_area);
   // Answer by Pick's theorem
-  cout << (twice_area - loop.size()) / 2 + 1 << '\n';
+  cout << (twice_area - length) / 2 + 1 << '\n';
 }
 
 int main(int argc, char **argv) {
@@ -6,70 +6,113 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <set>
+#include <algorithm>
 #include <cassert>
 
 using namespace std;
 
-using coord = pair<int, int>;
-
+// The total distance is affine in the expansion factor: each pair's
+// distance is the unexpanded distance plus (expansion - 1) times the
+// number of empty rows and columns crossed.  So one parse suffices
+// for any number of expansion factors.
+//
+// Only per-row and per-column galaxy counts are kept, so memory is
+// O(width + height) regardless of how many galaxies there are.
 struct the_final_frontier {
-  set<coord> galaxies;
-  // Distances from {0, 0}
-  vector<int> dr;
-  vector<int> dc;
+  // Number of galaxies in each row and column
+  vector<int> row_count;
+  vector<int> col_count;
+  // Sum over all pairs of unexpanded distances
+  long base;
+  // Sum over all pairs of the number of empty rows and columns crossed
+  long empties;
+
+  the_final_frontier();
 
-  the_final_frontier(int expansion);
+  // Cumulative distances from 0 along a dimension with the given
+  // galaxy counts, where nonempty rows/columns count as nonempty_step
+  // and empty ones as empty_step
+  static vector<long> delta(vector<int> const &count, long nonempty_step,
+                            long empty_step);
 
-  // Cumulative distances from 0 along dimension dim
-  vector<int> delta(int coord::*dim, int expansion) const;
+  // Sum over all pairs of galaxies of the distance along one
+  // dimension, given counts and positions along that dimension
+  static long axis_total(vector<int> const &count, vector<long> const &d);
+  // Sum over all pairs of both axes
+  long total(vector<long> const &dr, vector<long> const &dc) const;
 
-  int distance(coord const &g1, coord const &g2) const;
-  long total_distance() const;
+  __int128 total_distance(long expansion) const;
+  vector<__int128> total_distances(vector<long> const &expansions) const;
 };
 
-the_final_frontier::the_final_frontier(int expansion) {
+the_final_frontier::the_final_frontier() {
   string line;
   int row = 0;
   while (getline(cin, line)) {
+    col_count.resize(max(col_count.size(), line.length()), 0);
+    row_count.push_back(0);
     for (size_t col = 0; col < line.length(); ++col)
-      if (line[col] == '#')
-        galaxies.insert({row, col});
+      if (line[col] == '#') {
+        ++row_count[row];
+        ++col_count[col];
+      }
     ++row;
   }
-  dr = delta(&coord::first, expansion);
-  dc = delta(&coord::second, expansion);
+  base = total(delta(row_count, 1, 1), delta(col_count, 1, 1));
+  empties = total(delta(row_count, 0, 1), delta(col_count, 0, 1));
 }
 
-vector<int> the_final_frontier::delta(int coord::*dim, int expansion) const {
-  set<int> nonempty;
-  for (auto const &g : galaxies)
-    nonempty.insert(g.*dim);
-  // How could something nonempty ever be empty?  Why am I bothering
-  // to check this?
-  assert(!nonempty.empty());
-  vector<int> result(1, 0);
-  int max_d = *prev(nonempty.end());
-  for (int d = 0; d < max_d; ++d)
-    result.push_back(result.back() + (nonempty.count(d) ? 1 : expansion));
+vector<long> the_final_frontier::delta(vector<int> const &count,
+                                       long nonempty_step, long empty_step) {
+  vector<long> result(1, 0);
+  for (size_t d = 0; d + 1 < count.size(); ++d)
+    result.push_back(result.back() + (count[d] ? nonempty_step : empty_step));
   return result;
 }
 
-int the_final_frontier::distance(coord const &g1, coord const &g2) const {
+long the_final_frontier::axis_total(vector<int> const &count,
+                                    vector<long> const &d) {
+  // Positions are visited in sorted order, so galaxies at d[x] are
+  // paired with all the num_before ones at smaller positions
+  long ans = 0;
+  long num_before = 0;
+  long prefix = 0;
+  for (size_t x = 0; x < count.size(); ++x) {
+    ans += count[x] * (num_before * d[x] - prefix);
+    num_before += count[x];
+    prefix += count[x] * d[x];
+  }
+  return ans;
+}
+
+long the_final_frontier::total(vector<long> const &dr,
+                               vector<long> const &dc) const {
   // Since passing through galaxies is OK, this decomposes
-  return abs(dr[g2.first] - dr[g1.first]) + abs(dc[g2.second] - dc[g1.second]);
+  return axis_total(row_count, dr) + axis_total(col_count, dc);
 }
 
-long the_final_frontier::total_distance() const {
-  long ans = 0;
-  for (auto g1 = galaxies.begin(); g1 != galaxies.end(); ++g1)
-    for (auto g2 = next(g1); g2 != galaxies.end(); ++g2)
-      ans += distance(*g1, *g2);
-  return ans;
+__int128 the_final_frontier::total_distance(long expansion) const {
+  return base + __int128(expansion - 1) * empties;
+}
+
+vector<__int128>
+the_final_frontier::total_distances(vector<long> const &expansions) const {
+  vector<__int128> result;
+  for (auto expansion : expansions)
+    result.push_back(total_distance(expansion));
+  return result;
+}
+
+ostream &operator<<(ostream &out, __int128 n) {
+  if (n < 0)
+    return out << '-' << -n;
+  if (n >= 10)
+    out << n / 10;
+  return out << char('0' + n % 10);
 }
 
-void part1() { cout << the_final_frontier(2).total_distance() << '\n'; }
-void part2() { cout << the_final_frontier(1000000).total_distance() << '\n'; }
+void part1() { cout << the_final_frontier().total_distance(2) << '\n'; }
+void part2() { cout << the_final_frontier().total_distance(1000000) << '\n'; }
 
 int main(int argc, char **argv) {
   if (argc != 2) {
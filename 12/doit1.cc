@@ -1,107 +1,488 @@
 // -*- C++ -*-
-// g++ -std=c++17 -Wall -g -o doit1 doit1.cc
+// g++ -std=c++17 -Wall -g -pthread -o doit1 doit1.cc
 // ./doit1 1 < input  # part 1
 // ./doit1 2 < input  # part 2
+// ./doit1 2 1000000 < input  # part 2 with a different unfolding
+// Unfoldings over 1000 only work if every record can be handled by
+// the periodic method below; if not, a record that can't is reported.
 
 // Much better than the explicit cache in doit.cc, using the
 // observation that there's no need to be modifying the
 // representations of the condition or the groups.  Just a couple of
-// integer indexes suffices.
+// integer indexes suffices, so the cache becomes a flat table filled
+// in bottom up.
 
 #include <iostream>
-#include <sstream>
 #include <string>
 #include <vector>
-#include <map>
+#include <optional>
+#include <cstdint>
+#include <algorithm>
+#include <numeric>
+#include <atomic>
+#include <thread>
 #include <cassert>
 
 using namespace std;
 
-// conds index, group index
-using config = pair<unsigned, unsigned>;
-
-string conds;
-vector<unsigned> groups;
-map<config, size_t> ways;
-
-// Number of ways to match conds[ci, end) against groups[gi, end)
-size_t all_ways(unsigned ci, unsigned gi) {
-  if (ci >= conds.length())
-    // Nothing else in conds, are we at the end of groups?
-    return gi == groups.size() ? 1 : 0;
-  // Utility functions to process an empty space or a group
-  auto empty = [&]() -> size_t { return all_ways(ci + 1, gi); };
-  auto group = [&]() -> size_t {
-    if (gi == groups.size())
-      // No groups left
-      return 0;
-    unsigned num_in_group = groups[gi];
-    if (conds.length() - ci < num_in_group)
-      // The group is too long
-      return 0;
-    // The next num_in_group must all be #
-    for (unsigned i = ci + 1; i < ci + num_in_group; ++i)
-      if (conds[i] == '.')
-        // Group would end too soon
-        return 0;
-    if (ci + num_in_group < conds.size() && conds[ci + num_in_group] == '#')
-      // Group could not end at the right place
+// Records are independent, so they're counted by several threads.
+// Each thread owns one of these, and the buffers are reused from one
+// record to the next.
+struct counter {
+  // Record being counted (after unfolding)
+  string conds;
+  vector<unsigned> groups;
+  // Folded record as read
+  string folded_conds;
+  vector<unsigned> folded_groups;
+  // ways[ci * (groups.size() + 1) + gi] = number of ways to match
+  // conds[ci, end) against groups[gi, end)
+  vector<size_t> ways;
+  // run[ci] = length of the run of non-. starting at conds[ci]
+  vector<unsigned> run;
+
+  // Parse a line into folded_conds and folded_groups
+  void read(string const &line);
+  // Unfold into conds and groups
+  void unfold(unsigned long unfoldings);
+
+  // Number of ways to match all of conds against all of groups
+  size_t all_ways();
+  // Same, but bit-parallel for conds shorter than 128
+  size_t all_ways_bits() const;
+
+  // Number of ways for the folded record unfolded some number of
+  // times, without actually unfolding; see below
+  optional<size_t> all_ways_periodic(unsigned long unfoldings) const;
+
+  // Can all_ways_periodic handle the record?
+  bool periodic_applies() const;
+
+  // Explicit unfolding needs a table quadratic in the unfolding, so
+  // larger factors have to go through all_ways_periodic
+  static unsigned long const max_explicit = 1000;
+
+  // Ways for the record unfolded any number of times
+  size_t all_ways(unsigned long unfoldings);
+};
+
+void counter::read(string const &line) {
+  auto space = line.find(' ');
+  assert(space != string::npos);
+  folded_conds.assign(line, 0, space);
+  folded_groups.clear();
+  unsigned n = 0;
+  for (size_t i = space + 1; i <= line.length(); ++i)
+    if (i == line.length() || line[i] == ',') {
+      folded_groups.push_back(n);
+      n = 0;
+    } else
+      n = 10 * n + (line[i] - '0');
+}
+
+void counter::unfold(unsigned long unfoldings) {
+  conds.clear();
+  groups.clear();
+  for (unsigned long i = 0; i < unfoldings; ++i) {
+    if (i > 0)
+      conds.push_back('?');
+    conds += folded_conds;
+    groups.insert(groups.end(), folded_groups.begin(), folded_groups.end());
+  }
+}
+
+size_t counter::all_ways() {
+  unsigned len = conds.length();
+  unsigned ng = groups.size();
+  run.assign(len + 1, 0);
+  for (unsigned ci = len; ci-- > 0;)
+    run[ci] = conds[ci] == '.' ? 0 : run[ci + 1] + 1;
+  ways.assign((len + 1) * (ng + 1), 0);
+  auto at = [&](unsigned ci, unsigned gi) -> size_t & {
+    return ways[ci * (ng + 1) + gi];
+  };
+  // Nothing else in conds, are we at the end of groups?
+  at(len, ng) = 1;
+  for (unsigned ci = len; ci-- > 0;)
+    for (unsigned gi = 0; gi <= ng; ++gi) {
+      size_t result = 0;
+      if (conds[ci] != '#')
+        // Process an empty space
+        result += at(ci + 1, gi);
+      if (conds[ci] != '.' && gi < ng) {
+        // Process a group; the next num_in_group must all be # (or
+        // ?), and the group has to end at the right place
+        unsigned num_in_group = groups[gi];
+        unsigned end = ci + num_in_group;
+        if (run[ci] >= num_in_group && (end == len || conds[end] != '#'))
+          result += at(min(end + 1, len), gi + 1);
+      }
+      at(ci, gi) = result;
+    }
+  return at(0, 0);
+}
+
+using mask = unsigned __int128;
+
+unsigned ctz(mask m) {
+  assert(m != 0);
+  if (uint64_t(m) != 0)
+    return __builtin_ctzll(uint64_t(m));
+  return 64 + __builtin_ctzll(uint64_t(m >> 64));
+}
+
+size_t counter::all_ways_bits() const {
+  unsigned len = conds.length();
+  assert(len < 128);
+  // Bit i of not_dot/hash is set if conds[i] is not ./is #
+  mask not_dot = 0, hash = 0;
+  for (unsigned i = 0; i < len; ++i) {
+    not_dot |= mask(conds[i] != '.') << i;
+    hash |= mask(conds[i] == '#') << i;
+  }
+  mask in_range = (mask(1) << len) - 1;
+  // cnt[p] = ways to place the groups so far with conds[p] the first
+  // free position; reachable has bit p set if cnt[p] != 0
+  size_t cnt[129] = {1};
+  mask reachable = 1;
+  for (unsigned num_in_group : groups) {
+    if (!reachable)
       return 0;
-    // Consistent
-    return all_ways(ci + num_in_group + 1, gi + 1);
+    // Bit s of fits is set if the group can occupy [s, s +
+    // num_in_group), i.e., all non-., and not followed by a #.  The
+    // run of non-.s is built by doubling.
+    mask fits = not_dot;
+    for (unsigned have = 1; have < num_in_group;) {
+      unsigned shift = min(have, num_in_group - have);
+      fits &= fits >> shift;
+      have += shift;
+    }
+    fits &= ~(hash >> num_in_group);
+    fits &= in_range >> (num_in_group - 1);
+    // Nothing can start before the first reachable position
+    fits &= ~((reachable & -reachable) - 1);
+    size_t next[129] = {0};
+    mask next_reachable = 0;
+    // Sweep the interesting positions in order, accumulating ways to
+    // be free at s; a # can't be skipped, so it resets the sum
+    size_t acc = 0;
+    for (mask todo = reachable | fits | hash; todo; todo &= todo - 1) {
+      unsigned s = ctz(todo);
+      acc += cnt[s];
+      if (((fits >> s) & 1) && acc) {
+        unsigned end = min(s + num_in_group + 1, len);
+        next[end] += acc;
+        next_reachable |= mask(1) << end;
+      }
+      if ((hash >> s) & 1)
+        acc = 0;
+    }
+    copy(next, next + len + 1, cnt);
+    reachable = next_reachable;
+  }
+  // Whatever's left after the last group must not include a #
+  size_t result = 0;
+  for (unsigned p = len;; --p) {
+    result += cnt[p];
+    if (p == 0 || ((hash >> (p - 1)) & 1))
+      break;
+  }
+  return result;
+}
+
+// For huge unfoldings, the record is periodic: copies of
+// folded_conds separated by ?, matched against copies of
+// folded_groups.  Matching is done with an automaton whose local
+// states are positions within one block of groups: (j, t) means t #s
+// of group j have been seen (t = 0 means waiting for group j).  The
+// global state also needs the lag, i.e., the number of blocks
+// finished minus the number of copies of conds processed.  Each copy
+// is then a transfer matrix on (local state, lag), which is raised to
+// a power by repeated squaring.
+//
+// As long as the lag can't wander arbitrarily far on the way from the
+// start to the end, only a finite window of lags matters.  That's
+// true unless there are both ways to fall behind and ways to get
+// ahead around cycles, e.g., records with no # at all.  In that case
+// this returns nullopt.
+//
+// Counts are modulo 2^64, so large unfoldings give the answer mod
+// 2^64.
+optional<size_t> counter::all_ways_periodic(unsigned long unfoldings) const {
+  assert(unfoldings > 0 && !folded_groups.empty());
+  unsigned m = folded_groups.size();
+  // Local state numbering
+  vector<unsigned> base(m + 1, 0);
+  for (unsigned j = 0; j < m; ++j)
+    base[j + 1] = base[j] + folded_groups[j] + 1;
+  unsigned P = base[m];
+  unsigned last = P - 1;
+  // Successors of local state s on c, with 1 for finishing a block
+  auto step = [&](unsigned s, char c, auto &&emit) {
+    unsigned j = upper_bound(base.begin(), base.end(), s) - base.begin() - 1;
+    unsigned t = s - base[j];
+    if (c != '#' && (t == 0 || t == folded_groups[j])) {
+      if (t == 0)
+        emit(s, 0);
+      else if (j + 1 < m)
+        emit(base[j + 1], 0);
+      else
+        emit(0, 1);
+    }
+    if (c != '.' && t < folded_groups[j])
+      emit(s + 1, 0);
+  };
+  // trans[s][off * P + s'] = ways to get from s to s' finishing off
+  // blocks along the way, for one copy of conds
+  int max_off = folded_conds.length() + 2;
+  auto transfer = [&](string const &copy) {
+    vector<vector<size_t>> trans(P);
+    for (unsigned s0 = 0; s0 < P; ++s0) {
+      vector<size_t> cur((max_off + 1) * P, 0);
+      cur[s0] = 1;
+      for (char c : copy) {
+        vector<size_t> nxt((max_off + 1) * P, 0);
+        for (int off = 0; off <= max_off; ++off)
+          for (unsigned s = 0; s < P; ++s)
+            if (size_t n = cur[off * P + s])
+              step(s, c, [&](unsigned s1, int inc) {
+                assert(off + inc <= max_off);
+                nxt[(off + inc) * P + s1] += n;
+              });
+        cur.swap(nxt);
+      }
+      trans[s0] = move(cur);
+    }
+    return trans;
+  };
+  // All but the last copy are followed by a ?
+  auto T = transfer(folded_conds + '?');
+  auto F = transfer(folded_conds);
+  // Is the lag bounded?  Edges of the local graph have weight off - 1;
+  // look for both positive and negative cycles among the local
+  // states reachable from the start.
+  vector<bool> reach(P, false);
+  reach[0] = true;
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (unsigned s = 0; s < P; ++s)
+      if (reach[s])
+        for (int off = 0; off <= max_off; ++off)
+          for (unsigned s1 = 0; s1 < P; ++s1)
+            if (T[s][off * P + s1] && !reach[s1])
+              reach[s1] = changed = true;
+  }
+  auto has_cycle = [&](int sign) {
+    // Bellman-Ford with weights -sign * (off - 1)
+    vector<long> dist(P, 0);
+    for (unsigned iter = 0; iter <= P; ++iter) {
+      bool relaxed = false;
+      for (unsigned s = 0; s < P; ++s)
+        if (reach[s])
+          for (int off = 0; off <= max_off; ++off)
+            for (unsigned s1 = 0; s1 < P; ++s1)
+              if (T[s][off * P + s1] &&
+                  dist[s] - sign * (off - 1) < dist[s1]) {
+                dist[s1] = dist[s] - sign * (off - 1);
+                relaxed = true;
+              }
+      if (!relaxed)
+        return false;
+    }
+    return true;
+  };
+  if (has_cycle(+1) && has_cycle(-1))
+    return nullopt;
+  // With cycles in only one direction, the lag along a useful path
+  // stays within about twice the longest acyclic excursion
+  int d = max_off;
+  int C = 2 * P * d + d;
+  auto id = [&](unsigned s, int lag) { return (lag + C) * P + s; };
+  unsigned N = (2 * C + 1) * P;
+  // Forward reachability from the start, and backward from states
+  // where the final copy can accept
+  vector<bool> fwd(N, false), bwd(N, false);
+  vector<unsigned> todo{id(0, 0)};
+  fwd[id(0, 0)] = true;
+  while (!todo.empty()) {
+    unsigned x = todo.back();
+    todo.pop_back();
+    unsigned s = x % P;
+    int lag = int(x / P) - C;
+    for (int off = 0; off <= max_off; ++off) {
+      int lag1 = lag + off - 1;
+      if (lag1 < -C || lag1 > C)
+        continue;
+      for (unsigned s1 = 0; s1 < P; ++s1)
+        if (T[s][off * P + s1] && !fwd[id(s1, lag1)]) {
+          fwd[id(s1, lag1)] = true;
+          todo.push_back(id(s1, lag1));
+        }
+    }
+  }
+  // Does the last copy from (s, lag) accept?  Accepting means all
+  // blocks done, or the last group of the last block just finished.
+  auto accepts = [&](unsigned s, int lag) -> size_t {
+    size_t result = 0;
+    for (int off = 0; off <= max_off; ++off) {
+      int lag1 = lag + off - 1;
+      if (lag1 == 0)
+        result += F[s][off * P + 0];
+      else if (lag1 == -1)
+        result += F[s][off * P + last];
+    }
+    return result;
   };
-  if (conds[ci] == '.')
-    // Skip definite spaces
-    return empty();
-  if (conds[ci] == '#')
-    // The next group must start here
-    return group();
-  // Decision point, check cache
-  if (auto p = ways.find({ci, gi}); p != ways.end())
-    return p->second;
-  // Count both ways of setting the last ?
-  return ways[{ci, gi}] = empty() + group();
+  for (int lag = -C; lag <= C; ++lag)
+    for (unsigned s = 0; s < P; ++s)
+      if (accepts(s, lag)) {
+        bwd[id(s, lag)] = true;
+        todo.push_back(id(s, lag));
+      }
+  while (!todo.empty()) {
+    unsigned x = todo.back();
+    todo.pop_back();
+    unsigned s1 = x % P;
+    int lag1 = int(x / P) - C;
+    for (int off = 0; off <= max_off; ++off) {
+      int lag = lag1 - off + 1;
+      if (lag < -C || lag > C)
+        continue;
+      for (unsigned s = 0; s < P; ++s)
+        if (T[s][off * P + s1] && !bwd[id(s, lag)]) {
+          bwd[id(s, lag)] = true;
+          todo.push_back(id(s, lag));
+        }
+    }
+  }
+  // Only states on some path from start to finish matter
+  vector<unsigned> useful;
+  vector<int> index(N, -1);
+  for (unsigned x = 0; x < N; ++x)
+    if (fwd[x] && bwd[x]) {
+      index[x] = useful.size();
+      useful.push_back(x);
+    }
+  if (index[id(0, 0)] == -1)
+    return 0;
+  unsigned R = useful.size();
+  using matrix = vector<size_t>;
+  auto mul = [R](matrix const &a, matrix const &b) {
+    matrix c(R * R, 0);
+    for (unsigned i = 0; i < R; ++i)
+      for (unsigned k = 0; k < R; ++k)
+        if (size_t aik = a[i * R + k])
+          for (unsigned j = 0; j < R; ++j)
+            c[i * R + j] += aik * b[k * R + j];
+    return c;
+  };
+  matrix M(R * R, 0);
+  for (unsigned i = 0; i < R; ++i) {
+    unsigned s = useful[i] % P;
+    int lag = int(useful[i] / P) - C;
+    for (int off = 0; off <= max_off; ++off) {
+      int lag1 = lag + off - 1;
+      if (lag1 < -C || lag1 > C)
+        continue;
+      for (unsigned s1 = 0; s1 < P; ++s1)
+        if (int j = index[id(s1, lag1)]; j != -1)
+          M[i * R + j] += T[s][off * P + s1];
+    }
+  }
+  // v = start * M^(unfoldings - 1)
+  vector<size_t> v(R, 0);
+  v[index[id(0, 0)]] = 1;
+  for (unsigned long e = unfoldings - 1; e != 0; e >>= 1) {
+    if (e & 1) {
+      vector<size_t> w(R, 0);
+      for (unsigned i = 0; i < R; ++i)
+        if (v[i])
+          for (unsigned j = 0; j < R; ++j)
+            w[j] += v[i] * M[i * R + j];
+      v.swap(w);
+    }
+    if (e > 1)
+      M = mul(M, M);
+  }
+  size_t result = 0;
+  for (unsigned i = 0; i < R; ++i)
+    result += v[i] * accepts(useful[i] % P, int(useful[i] / P) - C);
+  return result;
+}
+
+bool counter::periodic_applies() const {
+  // Whether the lag is bounded doesn't depend on the unfolding, and a
+  // single copy skips the matrix powering
+  return all_ways_periodic(1).has_value();
+}
+
+size_t counter::all_ways(unsigned long unfoldings) {
+  // Explicit unfolding is cheaper for small factors
+  unsigned long const periodic_threshold = 16;
+  if (unfoldings > periodic_threshold)
+    if (auto result = all_ways_periodic(unfoldings))
+      return *result;
+  // solve() has checked this already
+  assert(unfoldings <= max_explicit);
+  unfold(unfoldings);
+  return conds.length() < 128 ? all_ways_bits() : all_ways();
 }
 
-void solve(int unfoldings) {
+void solve(unsigned long unfoldings) {
+  vector<string> lines;
   string line;
-  size_t ans = 0;
-  while (getline(cin, line)) {
-    stringstream ss(line);
-    ss >> conds;
-    groups = vector<unsigned>(1, 0);
-    char comma;
-    while (ss >> groups.back() >> comma)
-      groups.push_back(0);
-    conds.push_back('?');
-    // Unfold
-    auto unfolded_conds = conds;
-    auto unfolded_groups(groups);
-    for (int _ = 1; _ < unfoldings; ++_) {
-      unfolded_conds += conds;
-      unfolded_groups.insert(unfolded_groups.end(), groups.begin(),
-                             groups.end());
+  while (getline(cin, line))
+    if (!line.empty())
+      lines.push_back(line);
+  if (unfoldings > counter::max_explicit) {
+    // Make sure nothing needs explicit unfolding before starting
+    counter c;
+    for (auto const &l : lines) {
+      c.read(l);
+      if (!c.periodic_applies()) {
+        cerr << "can't unfold " << l << " that much\n";
+        exit(1);
+      }
     }
-    unfolded_conds.pop_back();
-    conds = unfolded_conds;
-    groups = unfolded_groups;
-    ways.clear();
-    ans += all_ways(0, 0);
   }
-  cout << ans << '\n';
+  unsigned num_threads = max(1u, thread::hardware_concurrency());
+  // Records are handed out in chunks to keep the shared counter cool
+  size_t const chunk = 256;
+  atomic<size_t> next_record{0};
+  vector<size_t> totals(num_threads, 0);
+  vector<thread> workers;
+  for (unsigned t = 0; t < num_threads; ++t)
+    workers.emplace_back([&, t] {
+      counter c;
+      size_t total = 0;
+      for (;;) {
+        size_t first = next_record.fetch_add(chunk);
+        if (first >= lines.size())
+          break;
+        size_t last = min(first + chunk, lines.size());
+        for (size_t i = first; i < last; ++i) {
+          c.read(lines[i]);
+          total += c.all_ways(unfoldings);
+        }
+      }
+      totals[t] = total;
+    });
+  for (auto &worker : workers)
+    worker.join();
+  cout << accumulate(totals.begin(), totals.end(), size_t(0)) << '\n';
 }
 
 void part1() { solve(1); }
-void part2() { solve(5); }
+void part2(unsigned long unfoldings) { solve(unfoldings); }
 
 int main(int argc, char **argv) {
-  if (argc != 2) {
-    cerr << "usage: " << argv[0] << " partnum < input\n";
+  if (argc != 2 && argc != 3) {
+    cerr << "usage: " << argv[0] << " partnum [unfoldings] < input\n";
     exit(1);
   }
   if (*argv[1] == '1')
     part1();
   else
-    part2();
+    part2(argc == 3 ? stoul(argv[2]) : 5);
   return 0;
 }
@@ -6,77 +6,195 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <functional>
+#include <cstdint>
 #include <cassert>
 
 using namespace std;
 
+// Hashing is mod the Mersenne prime 2^61 - 1
+uint64_t const hash_mod = (uint64_t(1) << 61) - 1;
+uint64_t const hash_base = 1000003;
+
+uint64_t mul_mod(uint64_t a, uint64_t b) {
+  unsigned __int128 p = (unsigned __int128)a * b;
+  uint64_t r = (uint64_t(p) & hash_mod) + uint64_t(p >> 61);
+  return r >= hash_mod ? r - hash_mod : r;
+}
+
+uint64_t add_mod(uint64_t a, uint64_t b) {
+  uint64_t r = a + b;
+  return r >= hash_mod ? r - hash_mod : r;
+}
+
+// Rows and columns are encoded as bits, so checking a reflection is
+// XOR and popcount, and there's no need to transpose anything.
+// Patterns too big for that use hashes of the rows and columns
+// instead.
 struct terrain {
-  vector<string> rows;
+  // Bit c of rows[r] (and bit r of cols[c]) is set for # at (r, c).
+  // For wide patterns, these are hashes of the rows and columns.
+  vector<uint64_t> rows;
+  vector<uint64_t> cols;
+  // The pattern itself, kept only if wide
+  vector<string> grid;
+  bool wide;
 
   // First line given, read rest from cin
   terrain(string line);
 
-  // Is there a horizontal reflection at row r, possibly considering
-  // smudging?
-  bool reflection(unsigned r, bool smudged) const;
-  // Find horizontal reflection; return number of rows, 0 if no reflection
-  unsigned reflection(bool smudged) const;
-
-  // Flip so I don't have to think
-  void transpose();
-
-  unsigned summarize(bool smudged);
+  // Is there a reflection between lines[r - 1] and lines[r], possibly
+  // considering smudging?
+  static bool reflection(vector<uint64_t> const &lines, unsigned r,
+                         bool smudged);
+  // Find reflection; return number of lines before it, 0 if no
+  // reflection
+  static unsigned reflection(vector<uint64_t> const &lines, bool smudged);
+  // Same for hashed lines; mismatches(i, j, cap) counts differing
+  // cells between lines i and j, stopping once it's over cap
+  static unsigned
+  reflection(vector<uint64_t> const &lines, bool smudged,
+             function<unsigned(unsigned, unsigned, unsigned)> mismatches);
+
+  unsigned summarize(bool smudged) const;
 };
 
 terrain::terrain(string line) {
   do {
-    rows.push_back(line);
+    grid.push_back(line);
+    assert(line.length() == grid.front().length());
     getline(cin, line);
   } while (!line.empty());
+  unsigned height = grid.size();
+  unsigned width = grid.front().length();
+  wide = height > 64 || width > 64;
+  rows.resize(height, 0);
+  cols.resize(width, 0);
+  for (unsigned r = 0; r < height; ++r)
+    for (unsigned c = 0; c < width; ++c) {
+      bool rock = grid[r][c] == '#';
+      if (wide) {
+        rows[r] = add_mod(mul_mod(rows[r], hash_base), rock ? 2 : 1);
+        cols[c] = add_mod(mul_mod(cols[c], hash_base), rock ? 2 : 1);
+      } else if (rock) {
+        rows[r] |= uint64_t(1) << c;
+        cols[c] |= uint64_t(1) << r;
+      }
+    }
+  if (!wide)
+    grid.clear();
 }
 
-bool smudged_match(string const &s1, string const &s2) {
-  assert(s1.length() == s2.length());
+bool terrain::reflection(vector<uint64_t> const &lines, unsigned r,
+                         bool smudged) {
+  // Smudging means exactly one mismatched bit overall
+  int allowed = smudged ? 1 : 0;
   int mismatches = 0;
-  for (size_t i = 0; i < s1.length(); ++i)
-    if (s1[i] != s2[i])
-      ++mismatches;
-  return mismatches == 1;
-}
-
-bool terrain::reflection(unsigned r, bool smudged) const {
-  for (unsigned r1 = r, r2 = r; r1-- > 0 && r2 < rows.size(); ++r2) {
-    if (rows[r1] == rows[r2])
-      continue;
-    if (!smudged || !smudged_match(rows[r1], rows[r2]))
+  for (unsigned r1 = r, r2 = r; r1-- > 0 && r2 < lines.size(); ++r2) {
+    mismatches += __builtin_popcountll(lines[r1] ^ lines[r2]);
+    if (mismatches > allowed)
       return false;
-    smudged = false;
   }
-  // Smudging was expected and wasn't found => false
-  return !smudged;
+  return mismatches == allowed;
 }
 
-unsigned terrain::reflection(bool smudged) const {
-  for (unsigned r = 1; r < rows.size(); ++r)
-    if (reflection(r, smudged))
+unsigned terrain::reflection(vector<uint64_t> const &lines, bool smudged) {
+  for (unsigned r = 1; r < lines.size(); ++r)
+    if (reflection(lines, r, smudged))
       return r;
   return 0;
 }
 
-void terrain::transpose() {
-  vector<string> new_rows(rows.front().length());
-  for (auto const &row : rows) {
-    assert(row.length() == new_rows.size());
-    for (size_t i = 0; i < row.length(); ++i)
-      new_rows[i].push_back(row[i]);
+unsigned terrain::reflection(
+    vector<uint64_t> const &lines, bool smudged,
+    function<unsigned(unsigned, unsigned, unsigned)> mismatches) {
+  unsigned n = lines.size();
+  // Manacher's algorithm for even palindromes: rad[r] = number of
+  // equal line pairs around the mirror between r - 1 and r
+  vector<unsigned> rad(n, 0);
+  for (int i = 0, l = 0, rr = -1; i < int(n); ++i) {
+    int k = i > rr ? 0 : min(int(rad[l + rr - i + 1]), rr - i + 1);
+    while (i + k < int(n) && i - k - 1 >= 0 &&
+           lines[i + k] == lines[i - k - 1])
+      ++k;
+    rad[i] = k;
+    if (i + k - 1 > rr) {
+      l = i - k;
+      rr = i + k - 1;
+    }
+  }
+  // Forward and backward prefix hashes of the line hashes, so that
+  // any run of pairs past a mismatch can be compared in O(1)
+  vector<uint64_t> fwd(n + 1, 0), bwd(n + 1, 0), power(n + 1, 1);
+  for (unsigned i = 0; i < n; ++i) {
+    fwd[i + 1] = add_mod(mul_mod(fwd[i], hash_base), lines[i]);
+    bwd[i + 1] = add_mod(mul_mod(bwd[i], hash_base), lines[n - 1 - i]);
+    power[i + 1] = mul_mod(power[i], hash_base);
   }
-  rows = new_rows;
+  auto segment = [&](vector<uint64_t> const &prefix, unsigned from,
+                     unsigned to) {
+    return add_mod(prefix[to],
+                   hash_mod - mul_mod(prefix[from], power[to - from]));
+  };
+  // Does lines[from, to) read backwards equal lines[from2, from2 + to
+  // - from)?
+  auto mirrored = [&](unsigned from, unsigned to, unsigned from2) {
+    return segment(bwd, n - to, n - from) ==
+           segment(fwd, from2, from2 + to - from);
+  };
+  // Confirm a candidate the slow way, in case of hash collisions
+  auto confirm = [&](unsigned r) {
+    unsigned total = 0;
+    for (unsigned r1 = r, r2 = r; r1-- > 0 && r2 < n; ++r2)
+      if ((total += mismatches(r1, r2, 1)) > 1)
+        return false;
+    return total == (smudged ? 1 : 0);
+  };
+  for (unsigned r = 1; r < n; ++r) {
+    unsigned k = min(r, n - r);
+    if (!smudged) {
+      if (rad[r] >= k && confirm(r))
+        return r;
+      continue;
+    }
+    if (rad[r] >= k)
+      // Perfect reflection, no smudge
+      continue;
+    // The first mismatched pair has to be the smudge, and everything
+    // beyond it has to match
+    unsigned r1 = r - 1 - rad[r], r2 = r + rad[r];
+    if (mismatches(r1, r2, 1) != 1)
+      continue;
+    if (mirrored(r - k, r1, r2 + 1) && confirm(r))
+      return r;
+  }
+  return 0;
 }
 
-unsigned terrain::summarize(bool smudged) {
-  unsigned above = 100 * reflection(smudged);
-  transpose();
-  unsigned left = reflection(smudged);
+unsigned terrain::summarize(bool smudged) const {
+  unsigned above, left;
+  if (!wide) {
+    above = 100 * reflection(rows, smudged);
+    left = reflection(cols, smudged);
+  } else {
+    above = 100 * reflection(rows, smudged,
+                             [&](unsigned r1, unsigned r2, unsigned cap) {
+                               unsigned result = 0;
+                               for (unsigned c = 0; c < cols.size(); ++c)
+                                 if (grid[r1][c] != grid[r2][c] &&
+                                     ++result > cap)
+                                   break;
+                               return result;
+                             });
+    left = reflection(cols, smudged,
+                      [&](unsigned c1, unsigned c2, unsigned cap) {
+                        unsigned result = 0;
+                        for (unsigned r = 0; r < rows.size(); ++r)
+                          if (grid[r][c1] != grid[r][c2] && ++result > cap)
+                            break;
+                        return result;
+                      });
+  }
   assert((above != 0) != (left != 0));
   return above + left;
 }
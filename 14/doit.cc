@@ -1,85 +1,235 @@
 // -*- C++ -*-
-// g++ -std=c++17 -Wall -g -o doit doit.cc
+// g++ -std=c++17 -Wall -g -pthread -o doit doit.cc
 // ./doit 1 < input  # part 1
 // ./doit 2 < input  # part 2
 
 #include <iostream>
 #include <string>
 #include <vector>
-#include <map>
-#include <optional>
+#include <random>
+#include <cstdint>
+#include <atomic>
+#include <thread>
 #include <cassert>
 
 using namespace std;
 
+// Bit matrices stored as lines of 64-bit words, with the number of
+// lines padded to a multiple of 64 so they can be transposed in 64x64
+// blocks
+struct bitboard {
+  // Words per line
+  int words;
+  // Bit i of line l is word i / 64 of l at bits[l * words + i / 64]
+  vector<uint64_t> bits;
+
+  bitboard(int num_lines = 0, int num_bits = 0)
+      : words((num_bits + 63) / 64),
+        bits(64 * ((num_lines + 63) / 64) * words, 0) {}
+
+  // Number of (padded) lines
+  int lines() const { return words ? bits.size() / words : 0; }
+  uint64_t *line(int l) { return &bits[l * words]; }
+  uint64_t const *line(int l) const { return &bits[l * words]; }
+  bool test(int l, int i) const { return (line(l)[i / 64] >> (i % 64)) & 1; }
+  void set(int l, int i) { line(l)[i / 64] |= uint64_t(1) << (i % 64); }
+
+  bitboard transposed() const;
+};
+
+// Run f(lo, hi) on pieces of [0, count), in parallel if there's
+// enough to be worth starting threads for
+template <typename Fn> void parallel_for(int count, Fn f) {
+  int const min_chunk = 256;
+  int num_threads = min<int>(max(1u, thread::hardware_concurrency()),
+                             (count + min_chunk - 1) / min_chunk);
+  if (num_threads <= 1) {
+    f(0, count);
+    return;
+  }
+  vector<thread> workers;
+  for (int t = 0; t < num_threads; ++t)
+    workers.emplace_back(f, long(count) * t / num_threads,
+                         long(count) * (t + 1) / num_threads);
+  for (auto &worker : workers)
+    worker.join();
+}
+
+// Transpose a 64x64 block in place, bit i of a[k] <-> bit k of a[i]
+void transpose64(uint64_t a[64]) {
+  uint64_t m = 0x00000000FFFFFFFF;
+  for (int j = 32; j != 0; j >>= 1, m ^= m << j)
+    for (int k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+      uint64_t t = ((a[k] >> j) ^ a[k | j]) & m;
+      a[k] ^= t << j;
+      a[k | j] ^= t;
+    }
+}
+
+bitboard bitboard::transposed() const {
+  int block_rows = lines() / 64;
+  bitboard result(64 * words, 64 * block_rows);
+  parallel_for(block_rows, [&](int lo, int hi) {
+    uint64_t block[64];
+    for (int bi = lo; bi < hi; ++bi)
+      for (int bj = 0; bj < words; ++bj) {
+        for (int k = 0; k < 64; ++k)
+          block[k] = line(64 * bi + k)[bj];
+        transpose64(block);
+        for (int k = 0; k < 64; ++k)
+          result.line(64 * bj + k)[bi] = block[k];
+      }
+  });
+  return result;
+}
+
+// Mask for bits [lo, hi) of a word, 0 <= lo <= hi <= 64
+uint64_t range_mask(int lo, int hi) {
+  uint64_t upto_hi = hi == 64 ? ~uint64_t(0) : (uint64_t(1) << hi) - 1;
+  return upto_hi & ~((uint64_t(1) << lo) - 1);
+}
+
+// Apply f(word, mask) to the words covering bits [a, b) of a line
+template <typename Word, typename Fn>
+void for_range(Word *line, int a, int b, Fn f) {
+  for (int w = a / 64; w * 64 < b; ++w)
+    f(line[w], range_mask(max(a - 64 * w, 0), min(b - 64 * w, 64)));
+}
+
+int count_range(uint64_t const *line, int a, int b) {
+  int result = 0;
+  for_range(line, a, b, [&](uint64_t const &word, uint64_t mask) {
+    result += __builtin_popcountll(word & mask);
+  });
+  return result;
+}
+
 struct control {
   // Size of the platform
-  int n;
-  // The state of the platform
-  vector<string> platform;
+  int height;
+  int width;
+  // Stretches of the lines between cubes, for lines being rows or
+  // lines being columns
+  using segment = pair<int, int>;
+  vector<vector<segment>> row_segments;
+  vector<vector<segment>> col_segments;
+  // Zobrist keys for each cell, indexed by (row, col) and (col, row)
+  vector<uint64_t> row_keys;
+  vector<uint64_t> col_keys;
+
+  // What changes when tilting
+  struct state {
+    // The rocks; by_row has bit c of line r set for a rock at (r, c),
+    // otherwise the rocks are transposed
+    bitboard rocks;
+    bool by_row;
+    // XOR of the keys of all the rocks
+    uint64_t zobrist;
+
+    // Exact comparison, with the hash as a quick filter
+    bool operator==(state const &other) const {
+      return zobrist == other.zobrist && by_row == other.by_row &&
+             rocks.bits == other.rocks.bits;
+    }
+  } st;
 
   control();
 
   enum { north = 0, west, south, east };
-  // Tilt the platform in the direction indicated by orient
+  // Tilt the platform in the direction indicated by orient.  Lines
+  // are independent, so they're split across threads.
   void tilt(int orient = north);
   // Run a cycle north, west, south, east
   void cycle();
 
   // What's the load (always north-oriented)?
-  int load() const;
-
-  // Some random hash function for cycle detection
-  size_t hash() const;
+  long load() const;
 };
 
 control::control() {
+  vector<string> platform;
   string line;
   while (getline(cin, line)) {
     platform.push_back(line);
     assert(line.length() == platform.front().length());
   }
-  // For simplicity I just did the square case, which is what the
-  // input is
-  assert(platform.front().length() == platform.size());
-  n = platform.size();
+  height = platform.size();
+  width = platform.front().length();
+  mt19937_64 gen(20231214);
+  row_keys.resize(height * width);
+  col_keys.resize(height * width);
+  for (int r = 0; r < height; ++r)
+    for (int c = 0; c < width; ++c)
+      row_keys[r * width + c] = col_keys[c * height + r] = gen();
+  st.rocks = bitboard(height, width);
+  st.by_row = true;
+  st.zobrist = 0;
+  bitboard cubes(height, width);
+  for (int r = 0; r < height; ++r)
+    for (int c = 0; c < width; ++c)
+      if (platform[r][c] == 'O') {
+        st.rocks.set(r, c);
+        st.zobrist ^= row_keys[r * width + c];
+      } else if (platform[r][c] == '#')
+        cubes.set(r, c);
+  auto segments = [](bitboard const &b, int num_lines, int len) {
+    vector<vector<segment>> result(num_lines);
+    for (int l = 0; l < num_lines; ++l)
+      for (int i = 0; i < len;) {
+        int j = i;
+        while (j < len && !b.test(l, j))
+          ++j;
+        if (j > i)
+          result[l].emplace_back(i, j);
+        i = j + 1;
+      }
+    return result;
+  };
+  row_segments = segments(cubes, height, width);
+  col_segments = segments(cubes.transposed(), width, height);
 }
 
 void control::tilt(int orient) {
-  // The algorithm is written just for "north", and the coordinate
-  // mucking for orientation happens in the utility function at()
-  auto at = [&](int r, int c) -> char & {
-    switch (orient) {
-    case north:
-      return platform[r][c];
-    case west:
-      return platform[c][r];
-    case south:
-      return platform[n - 1 - r][c];
-    default:
-      return platform[c][n - 1 - r];
-    }
-  };
-  for (int c = 0; c < n; ++c) {
-    // -1 means no place to roll
-    int const none = -1;
-    int roll_to = none;
-    for (int r = 0; r < n; ++r) {
-      char &what = at(r, c);
-      if (what == '#')
-        // None shall pass!
-        roll_to = none;
-      else if (roll_to == none) {
-        if (what == '.')
-          roll_to = r;
-      } else if (what == 'O') {
-        // Make like a rock and roll
-        at(roll_to++, c) = 'O';
-        // A new free space where the rock was
-        what = '.';
+  // North and south work on columns, east and west on rows
+  bool want_by_row = orient == west || orient == east;
+  if (st.by_row != want_by_row) {
+    st.rocks = st.rocks.transposed();
+    st.by_row = want_by_row;
+  }
+  auto const &segments = st.by_row ? row_segments : col_segments;
+  auto const &keys = st.by_row ? row_keys : col_keys;
+  int num_lines = st.by_row ? height : width;
+  int len = st.by_row ? width : height;
+  bool toward_low = orient == north || orient == west;
+  atomic<uint64_t> zobrist{st.zobrist};
+  parallel_for(num_lines, [&](int lo_line, int hi_line) {
+    // Changes to the hash from this piece
+    uint64_t delta = 0;
+    for (int l = lo_line; l < hi_line; ++l) {
+      uint64_t *line = st.rocks.line(l);
+      uint64_t const *line_keys = &keys[l * len];
+      for (auto [a, b] : segments[l]) {
+        // Everything in the segment rolls to one end
+        int k = count_range(line, a, b);
+        if (k == 0 || k == b - a)
+          continue;
+        int lo = toward_low ? a : b - k;
+        for (int w = a / 64; w * 64 < b; ++w) {
+          uint64_t seg = range_mask(max(a - 64 * w, 0), min(b - 64 * w, 64));
+          int fill_lo = min(max(lo - 64 * w, 0), 64);
+          int fill_hi = min(max(lo + k - 64 * w, 0), 64);
+          uint64_t fill = fill_lo < fill_hi ? range_mask(fill_lo, fill_hi) : 0;
+          uint64_t rolled = (line[w] & ~seg) | fill;
+          // Only the rocks that actually moved change the hash
+          for (uint64_t moved = line[w] ^ rolled; moved; moved &= moved - 1)
+            delta ^= line_keys[64 * w + __builtin_ctzll(moved)];
+          line[w] = rolled;
+        }
       }
     }
-  }
+    zobrist ^= delta;
+  });
+  st.zobrist = zobrist;
 }
 
 void control::cycle() {
@@ -87,25 +237,20 @@ void control::cycle() {
     tilt(orient);
 }
 
-int control::load() const {
-  int result = 0;
-  for (int r = 0; r < n; ++r)
-    for (int c = 0; c < n; ++c)
-      if (platform[r][c] == 'O')
-        result += n - r;
-  return result;
-}
-
-size_t control::hash() const {
-  size_t result = 0;
-  int const nbits = 8 * sizeof(result);
-  for (int r = 0; r < n; ++r)
-    for (char c : platform[r]) {
-      // Times some random prime, rotate, add next
-      result *= 19650143;
-      result = (result << (nbits - 3)) | (result >> 3);
-      result += c;
-    }
+long control::load() const {
+  atomic<long> result{0};
+  int num_lines = st.by_row ? height : width;
+  parallel_for(num_lines, [&](int lo, int hi) {
+    long partial = 0;
+    for (int l = lo; l < hi; ++l)
+      if (st.by_row)
+        partial += long(height - l) * count_range(st.rocks.line(l), 0, width);
+      else
+        for (int r = 0; r < height; ++r)
+          if (st.rocks.test(l, r))
+            partial += height - r;
+    result += partial;
+  });
   return result;
 }
 
@@ -118,24 +263,29 @@ void part1() {
 void part2() {
   int const num_steps = 1000000000;
   control ctrl;
-  map<size_t, int> seen;
+  // Brent's cycle detection.  The tortoise is the only stored
+  // snapshot; it sits at powers of two while the hare runs ahead.
+  // Once they match, the hare is in the cycle and can skip ahead by
+  // multiples of its length.
+  auto tortoise = ctrl.st;
   int step = 0;
-  optional<int> cycle_length;
+  int power = 1, cycle_length = 0;
   while (step < num_steps) {
-    ++step;
     ctrl.cycle();
-    if (!cycle_length) {
-      auto h = ctrl.hash();
-      if (!seen.count(h))
-        seen[h] = step;
-      else {
-        cycle_length = step - seen[h];
-        int num_remaining = num_steps - step;
-        int cycles_remaining = num_remaining / *cycle_length;
-        step += cycles_remaining * *cycle_length;
-      }
+    ++step;
+    ++cycle_length;
+    if (ctrl.st == tortoise)
+      break;
+    if (cycle_length == power) {
+      tortoise = ctrl.st;
+      power *= 2;
+      cycle_length = 0;
     }
   }
+  if (step < num_steps)
+    for (int remaining = (num_steps - step) % cycle_length; remaining > 0;
+         --remaining)
+      ctrl.cycle();
   cout << ctrl.load() << '\n';
 }
 
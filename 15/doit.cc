@@ -5,30 +5,19 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <unordered_map>
 #include <array>
 #include <algorithm>
+#include <cstring>
 #include <cctype>
 #include <cstdint>
 #include <cassert>
 
 using namespace std;
 
-vector<string> steps;
-
-void read() {
-  char c;
-  steps.push_back("");
-  while (cin >> c)
-    if (c == '\n')
-      continue;
-    else if (c == ',')
-      steps.push_back("");
-    else
-      steps.back().push_back(c);
-}
-
-uint8_t HASH(string const &s) {
+uint8_t HASH(string_view s) {
   uint8_t current_value = 0;
   for (auto c : s) {
     current_value += uint8_t(c);
@@ -37,58 +26,209 @@ uint8_t HASH(string const &s) {
   return current_value;
 }
 
-using lens = pair<string, int>;
-using box = vector<lens>;
+// Sum of HASH over the comma-separated steps in [begin, end).  Steps
+// are hashed a batch at a time, one step per lane.  Each batch is
+// transposed so that character j of every step is contiguous, and the
+// recurrence runs over all lanes at once on 8-bit values (which the
+// compiler vectorizes).  Lanes whose step has ended are masked off.
+size_t HASH_all(char const *begin, char const *end) {
+  constexpr int lanes = 32;
+  size_t result = 0;
+  char const *starts[lanes];
+  size_t lengths[lanes];
+  vector<uint8_t> chars, masks;
+  char const *p = begin;
+  bool done = false;
+  while (!done) {
+    // Gather a batch of steps
+    int num = 0;
+    size_t max_len = 0;
+    while (num < lanes && !done) {
+      auto comma = static_cast<char const *>(memchr(p, ',', end - p));
+      char const *step_end = comma ? comma : end;
+      starts[num] = p;
+      lengths[num] = step_end - p;
+      max_len = max(max_len, lengths[num]);
+      ++num;
+      if (comma)
+        p = comma + 1;
+      else
+        done = true;
+    }
+    // Transpose
+    chars.assign(max_len * lanes, 0);
+    masks.assign(max_len * lanes, 0);
+    for (int l = 0; l < num; ++l)
+      for (size_t j = 0; j < lengths[l]; ++j) {
+        chars[j * lanes + l] = starts[l][j];
+        masks[j * lanes + l] = 0xff;
+      }
+    // Run the recurrence across lanes
+    uint8_t values[lanes] = {0};
+    for (size_t j = 0; j < max_len; ++j) {
+      uint8_t const *cs = &chars[j * lanes];
+      uint8_t const *ms = &masks[j * lanes];
+      for (int l = 0; l < lanes; ++l) {
+        uint8_t next = uint8_t(values[l] + cs[l]) * 17;
+        values[l] = (next & ms[l]) | (values[l] & ~ms[l]);
+      }
+    }
+    for (int l = 0; l < num; ++l)
+      result += values[l];
+  }
+  return result;
+}
+
+// Read the initialization sequence from stdin a block at a time,
+// dropping whitespace, and call f(begin, end) on each run of complete
+// comma-separated steps.  The input is never held all at once; a step
+// that straddles blocks is carried over (it's only as long as the
+// step) and passed to f on its own once it's complete.
+template <typename Fn> void for_each_run(Fn f) {
+  constexpr size_t block_size = 1 << 16;
+  vector<char> block(block_size);
+  string carry;
+  for (;;) {
+    cin.read(block.data(), block_size);
+    size_t n = cin.gcount();
+    if (n == 0)
+      break;
+    char *p = block.data();
+    char *end = remove_if(p, p + n, [](char c) { return isspace(c); });
+    auto first_comma = static_cast<char *>(memchr(p, ',', end - p));
+    if (!first_comma) {
+      carry.append(p, end);
+      continue;
+    }
+    // Finish the carried step
+    carry.append(p, first_comma);
+    f(carry.data(), carry.data() + carry.size());
+    p = first_comma + 1;
+    // Everything up to the last comma is complete
+    char *last = end;
+    while (last != p && last[-1] != ',')
+      --last;
+    if (last != p)
+      f(p, last - 1);
+    carry.assign(last, end);
+  }
+  if (!carry.empty())
+    f(carry.data(), carry.data() + carry.size());
+}
 
+// Call f on each comma-separated step in [begin, end)
+template <typename Fn>
+void for_each_step(char const *begin, char const *end, Fn f) {
+  for (;;) {
+    auto comma = static_cast<char const *>(memchr(begin, ',', end - begin));
+    f(string_view(begin, (comma ? comma : end) - begin));
+    if (!comma)
+      break;
+    begin = comma + 1;
+  }
+}
+
+// Each label is interned to an integer id when first seen, and each
+// box is a doubly-linked list threaded through the per-label lens
+// records, so all the operations are O(1)
 struct lenses {
-  array<box, 256> boxes;
+  static constexpr int none = -1;
+  struct lens {
+    // Box (HASH of the label)
+    uint8_t box;
+    // Is it currently in its box?
+    bool in_box = false;
+    int focal_length = 0;
+    // Neighbors in the box
+    int prev, next;
+  };
+  unordered_map<string, int> label_ids;
+  // Reused for lookups, so a label that's already known doesn't cost
+  // an allocation
+  string key;
+  vector<lens> all_lenses;
+  // First and last lens in each box
+  array<int, 256> head;
+  array<int, 256> tail;
+
+  lenses();
+
+  // Get the id for a label
+  int intern(string_view label);
 
-  void HASHMAP(string const &step);
+  void HASHMAP(string_view step);
 
   int focusing_power() const;
 };
 
-void lenses::HASHMAP(string const &step) {
+lenses::lenses() {
+  head.fill(none);
+  tail.fill(none);
+}
+
+int lenses::intern(string_view label) {
+  key.assign(label);
+  if (auto p = label_ids.find(key); p != label_ids.end())
+    return p->second;
+  int id = all_lenses.size();
+  label_ids.emplace(key, id);
+  all_lenses.emplace_back();
+  all_lenses.back().box = HASH(label);
+  return id;
+}
+
+void lenses::HASHMAP(string_view step) {
   assert(step.length() >= 2);
   size_t op_pos = step.length() - (step.back() == '-' ? 1 : 2);
   char op = step[op_pos];
   assert(op == '-' || op == '=');
-  string label(step.begin(), step.begin() + op_pos);
-  assert(!label.empty());
-  auto &box = boxes[HASH(label)];
-  auto p = find_if(box.begin(), box.end(),
-                   [&](lens const &l) { return l.first == label; });
+  assert(op_pos > 0);
+  int id = intern(step.substr(0, op_pos));
+  auto &l = all_lenses[id];
   if (op == '=') {
-    int focal_length = step.back() - '0';
-    if (p != box.end())
-      p->second = focal_length;
-    else
-      box.emplace_back(label, focal_length);
-  } else if (p != box.end())
-    box.erase(p);
+    l.focal_length = step.back() - '0';
+    if (!l.in_box) {
+      // Append to the box
+      l.in_box = true;
+      l.prev = tail[l.box];
+      l.next = none;
+      if (l.prev != none)
+        all_lenses[l.prev].next = id;
+      else
+        head[l.box] = id;
+      tail[l.box] = id;
+    }
+  } else if (l.in_box) {
+    // Unlink from the box
+    l.in_box = false;
+    (l.prev != none ? all_lenses[l.prev].next : head[l.box]) = l.next;
+    (l.next != none ? all_lenses[l.next].prev : tail[l.box]) = l.prev;
+  }
 }
 
 int lenses::focusing_power() const {
   int result = 0;
-  for (size_t box_num = 0; box_num < boxes.size(); ++box_num) {
-    auto const &box = boxes[box_num];
-    for (size_t slot_num = 0; slot_num < box.size(); ++slot_num)
-      result += (box_num + 1) * (slot_num + 1) * box[slot_num].second;
+  for (size_t box_num = 0; box_num < head.size(); ++box_num) {
+    int slot_num = 1;
+    for (int id = head[box_num]; id != none; id = all_lenses[id].next)
+      result += (box_num + 1) * slot_num++ * all_lenses[id].focal_length;
   }
   return result;
 }
 
 void part1() {
-  size_t ans = 0;
-  for (auto const &s : steps)
-    ans += HASH(s);
-  cout << ans << '\n';
+  size_t result = 0;
+  for_each_run([&](char const *begin, char const *end) {
+    result += HASH_all(begin, end);
+  });
+  cout << result << '\n';
 }
 
 void part2() {
   lenses ls;
-  for (auto const &s : steps)
-    ls.HASHMAP(s);
+  for_each_run([&](char const *begin, char const *end) {
+    for_each_step(begin, end, [&](string_view step) { ls.HASHMAP(step); });
+  });
   cout << ls.focusing_power() << '\n';
 }
 
@@ -97,7 +237,6 @@ int main(int argc, char **argv) {
     cerr << "usage: " << argv[0] << " partnum < input\n";
     exit(1);
   }
-  read();
   if (*argv[1] == '1')
     part1();
   else
@@ -83,20 +83,29 @@ coord operator+(coord const &c1, coord const &c2) {
   return {c1[0] + c2[0], c1[1] + c2[1]};
 }
 
-vector<coord> directions;
-
-int find_dir(coord const &c) {
-  for (size_t dir = 0; dir < directions.size(); ++dir)
-    if (c == directions[dir])
-      return dir;
-  directions.push_back(c);
-  return directions.size() - 1;
-}
-
-int const rt = find_dir({+1, 0});
-int const up = find_dir({0, +1});
-int const lt = find_dir({-1, 0});
-int const dn = find_dir({0, -1});
+// Directions, counterclockwise starting from the right
+int const rt = 0;
+int const up = 1;
+int const lt = 2;
+int const dn = 3;
+
+constexpr array<coord, 4> directions{{{+1, 0}, {0, +1}, {-1, 0}, {0, -1}}};
+
+// out_dirs[contents][dir] is the bit set of outgoing directions for a
+// beam coming into a tile with the given contents in direction dir
+constexpr auto out_dirs = [] {
+  array<array<uint8_t, 4>, 256> result{};
+  for (auto &row : result)
+    for (int dir = 0; dir < 4; ++dir)
+      row[dir] = 1 << dir;
+  // Mirrors swap the coordinates (with a sign flip for '\\')
+  result['/'] = {1 << up, 1 << rt, 1 << dn, 1 << lt};
+  result['\\'] = {1 << dn, 1 << lt, 1 << up, 1 << rt};
+  // Splitters only split perpendicular beams
+  result['|'][rt] = result['|'][lt] = (1 << up) | (1 << dn);
+  result['-'][up] = result['-'][dn] = (1 << rt) | (1 << lt);
+  return result;
+}();
 
 // State for strongly-connected component analysis (Tarjan)
 // index, lowlink, on_stack
@@ -135,10 +144,10 @@ struct tile {
   // tile energized?  This also resets beam_dirs.
   bool energized(scc_set sccs = 0);
 
-  // Return the outgoing directions for a beam that is coming in from
-  // direction dir.  If the incoming beam has already been traced (as
-  // recorded by beam_dirs), returns an empty vector.
-  vector<int> shoot(int dir);
+  // Return the bit set of outgoing directions for a beam that is
+  // coming in from direction dir.  If the incoming beam has already
+  // been traced (as recorded by beam_dirs), returns 0.
+  int shoot(int dir);
 
   // Is the given direction part of a nontrivial SCC?  If so, add the
   // SCC to the set and return true; otherwise return false.
@@ -164,21 +173,12 @@ bool tile::energized(scc_set sccs) {
   return result;
 }
 
-vector<int> tile::shoot(int dir) {
+int tile::shoot(int dir) {
   if ((beam_dirs & (1 << dir)) != 0)
     // Already explicitly traced
-    return {};
+    return 0;
   beam_dirs |= 1 << dir;
-  if (contents == '/')
-    return {find_dir({directions[dir][1], directions[dir][0]})};
-  if (contents == '\\')
-    return {find_dir({-directions[dir][1], -directions[dir][0]})};
-  bool horizontal = directions[dir][0] != 0;
-  if (contents == '|' && horizontal)
-    return {up, dn};
-  if (contents == '-' && !horizontal)
-    return {rt, lt};
-  return {dir};
+  return out_dirs[uint8_t(contents)][dir];
 }
 
 bool tile::in_nontrivial_scc(int dir, scc_set &sccs) const {
@@ -193,26 +193,26 @@ bool tile::in_nontrivial_scc(int dir, scc_set &sccs) const {
 }
 
 void tile::verify() {
-  assert(tile('/').shoot(rt) == vector<int>{up});
-  assert(tile('/').shoot(lt) == vector<int>{dn});
-  assert(tile('/').shoot(up) == vector<int>{rt});
-  assert(tile('/').shoot(dn) == vector<int>{lt});
-  assert(tile('\\').shoot(rt) == vector<int>{dn});
-  assert(tile('\\').shoot(lt) == vector<int>{up});
-  assert(tile('\\').shoot(up) == vector<int>{lt});
-  assert(tile('\\').shoot(dn) == vector<int>{rt});
-  vector<int> updown{up, dn};
+  assert(tile('/').shoot(rt) == 1 << up);
+  assert(tile('/').shoot(lt) == 1 << dn);
+  assert(tile('/').shoot(up) == 1 << rt);
+  assert(tile('/').shoot(dn) == 1 << lt);
+  assert(tile('\\').shoot(rt) == 1 << dn);
+  assert(tile('\\').shoot(lt) == 1 << up);
+  assert(tile('\\').shoot(up) == 1 << lt);
+  assert(tile('\\').shoot(dn) == 1 << rt);
+  int updown = (1 << up) | (1 << dn);
   assert(tile('|').shoot(rt) == updown);
   assert(tile('|').shoot(lt) == updown);
-  vector<int> rightleft{rt, lt};
+  int rightleft = (1 << rt) | (1 << lt);
   assert(tile('-').shoot(up) == rightleft);
   assert(tile('-').shoot(dn) == rightleft);
-  assert(tile('.').shoot(up) == vector<int>{up});
-  assert(tile('|').shoot(dn) == vector<int>{dn});
-  assert(tile('-').shoot(rt) == vector<int>{rt});
+  assert(tile('.').shoot(up) == 1 << up);
+  assert(tile('|').shoot(dn) == 1 << dn);
+  assert(tile('-').shoot(rt) == 1 << rt);
   tile t('.');
-  assert(t.shoot(rt) == vector<int>{rt});
-  assert(t.shoot(rt).empty());
+  assert(t.shoot(rt) == 1 << rt);
+  assert(t.shoot(rt) == 0);
   assert(t.energized());
 }
 
@@ -223,6 +223,8 @@ struct cave {
   // The tiles in read order (i.e., layout[0] is the top row, which is
   // at y == height - 1)
   vector<vector<tile>> layout;
+  // Beams traced by shoot() (reserved for the worst case)
+  vector<pair<coord, int>> to_shoot;
 
   cave();
 
@@ -259,6 +261,7 @@ cave::cave() {
       layout.back().emplace_back(tile(c));
     assert(layout.back().size() == layout.front().size());
   }
+  to_shoot.reserve(8 * width() * height() + 1);
 }
 
 bool cave::in_bounds(coord const &c) const {
@@ -270,9 +273,10 @@ tile &cave::at(coord const &c) { return layout[height() - 1 - c[1]][c[0]]; }
 vector<node> cave::successors(node const &v) {
   auto [c, dir] = v;
   vector<node> result;
-  for (int next_dir : at(c).shoot(dir)) {
+  int next_dirs = at(c).shoot(dir);
+  for (int next_dir = 0; next_dirs != 0; ++next_dir, next_dirs >>= 1) {
     auto next_c = c + directions[next_dir];
-    if (in_bounds(next_c))
+    if ((next_dirs & 1) != 0 && in_bounds(next_c))
       result.emplace_back(next_c, next_dir);
   }
   // Be sure to clear the beam state, since I'm not really shooting
@@ -350,7 +354,7 @@ void cave::tarjan() {
 }
 
 int cave::shoot(coord const &start, int start_dir, scc_action action) {
-  vector<pair<coord, int>> to_shoot;
+  to_shoot.clear();
   to_shoot.emplace_back(start, start_dir);
   scc_set sccs = 0;
   size_t next = 0;
@@ -361,9 +365,10 @@ int cave::shoot(coord const &start, int start_dir, scc_action action) {
     if (action == consider_sccs && t.in_nontrivial_scc(dir, sccs))
       // Cutoff due to reaching a nontrivial SCC
       continue;
-    for (int next_dir : t.shoot(dir)) {
+    int next_dirs = t.shoot(dir);
+    for (int next_dir = 0; next_dirs != 0; ++next_dir, next_dirs >>= 1) {
       auto nc = c + directions[next_dir];
-      if (in_bounds(nc))
+      if ((next_dirs & 1) != 0 && in_bounds(nc))
         to_shoot.emplace_back(nc, next_dir);
     }
   }